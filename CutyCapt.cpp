@@ -32,11 +32,20 @@
 
 #include "CutyCapt.hpp"
 #include <QByteArray>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QNetworkProxy>
 #include <QNetworkRequest>
+#include <QSaveFile>
 #include <QTimer>
+#include <QUuid>
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <vector>
 #include <qsgrendererinterface.h>
 #include <qwebenginesettings.h>
 
@@ -68,6 +77,74 @@ static struct _CutyExtMap {
 	{ CutyCapt::OtherFormat, "", "" }
 };
 
+// Exit status when the renderer process died on every attempt
+static const int CutyExitRendererCrashed = 2;
+
+// Upper bound for --materialize-lazy, on top of the regular --max-wait
+static const int CutyLazyMaxWait = 10000;
+static const int CutyLazyPollInterval = 100;
+
+// Switches lazy images and frames to eager loading, steps through the page
+// so IntersectionObserver based loaders see every part of it, and then sets
+// window.__cutyLazyDone once no image is pending and no new resources were
+// requested for half a second. Resources are counted by an observer, as the
+// resource timing buffer stops growing once it is full.
+static const char* CutyLazyScript = R"(
+(function() {
+  if (window.__cutyLazyStarted)
+    return;
+  window.__cutyLazyStarted = true;
+
+  var lazy = document.querySelectorAll('img[loading="lazy"], iframe[loading="lazy"]');
+  for (var i = 0; i < lazy.length; ++i)
+    lazy[i].loading = 'eager';
+
+  var step = Math.max(window.innerHeight, 1);
+  var y = 0;
+  var resources = 0;
+  var seen = -1;
+  var quiet = 0;
+
+  new PerformanceObserver(function(list) {
+    resources += list.getEntries().length;
+  }).observe({ type: 'resource', buffered: true });
+
+  function pending() {
+    for (var i = 0; i < document.images.length; ++i)
+      if (!document.images[i].complete)
+        return true;
+    return false;
+  }
+
+  function settle() {
+    quiet = resources == seen ? quiet + 1 : 0;
+    seen = resources;
+
+    if (pending() || quiet < 5) {
+      setTimeout(settle, 100);
+      return;
+    }
+
+    window.__cutyLazyDone = true;
+  }
+
+  function walk() {
+    var height = document.documentElement.scrollHeight;
+    if (y < height) {
+      window.scrollTo(0, y);
+      y += step;
+      setTimeout(walk, 50);
+      return;
+    }
+
+    window.scrollTo(0, 0);
+    settle();
+  }
+
+  walk();
+})();
+)";
+
 QString CutyPage::chooseFile(QWebEnginePage* /*frame*/, const QString& /*suggestedFile*/) {
 	return QString{};
 }
@@ -136,6 +213,485 @@ void CutyPage::setAttribute(Qt::WidgetAttribute option, const bool value) {
 	QWidget::setAttribute(option, value);
 }
 
+// Animated output. Frames after the first only carry the bounding box of
+// the pixels that changed, GIF and MNG draw them over the previous frame
+// and APNG does the same with dispose and blend both set to zero.
+
+static quint32 Crc32(const QByteArray& data) {
+	static quint32 table[256];
+
+	if (!table[1]) {
+		for (quint32 n = 0; n < 256; ++n) {
+			quint32 c = n;
+			for (int k = 0; k < 8; ++k)
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+	}
+
+	quint32 crc = 0xffffffffu;
+	for (const char byte : data)
+		crc = table[(crc ^ static_cast<uchar>(byte)) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffffu;
+}
+
+static void PngChunk(QIODevice* out, const char* type, const QByteArray& data) {
+	QByteArray chunk(type, 4);
+	chunk.append(data);
+
+	QDataStream s(out);
+	s << quint32(data.size());
+	out->write(chunk);
+	s << Crc32(chunk);
+}
+
+static QByteArray PngImageData(const QImage& image, const QRect& rect) {
+	QByteArray raw;
+	raw.reserve((rect.width() * 4 + 1) * rect.height());
+
+	for (int y = rect.top(); y <= rect.bottom(); ++y) {
+		const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+
+		raw.append('\0'); // filter type None
+		for (int x = rect.left(); x <= rect.right(); ++x) {
+			raw.append(static_cast<char>(qRed(line[x])));
+			raw.append(static_cast<char>(qGreen(line[x])));
+			raw.append(static_cast<char>(qBlue(line[x])));
+			raw.append(static_cast<char>(qAlpha(line[x])));
+		}
+	}
+
+	// qCompress prepends the uncompressed length to the zlib stream
+	return qCompress(raw).mid(4);
+}
+
+static QByteArray PngHeader(const QSize& size) {
+	QByteArray data;
+	QDataStream s(&data, QIODevice::WriteOnly);
+	s << quint32(size.width()) << quint32(size.height());
+	s << quint8(8) << quint8(6) << quint8(0) << quint8(0) << quint8(0); // 8-bit RGBA
+	return data;
+}
+
+// Maps pixels onto a fixed 6x7x6 colour cube. This is plain integer
+// arithmetic without table lookups or branches, so compilers vectorize
+// the loop, and unchanged pixels always get the same index, which keeps
+// the delta frames free of palette noise.
+static void QuantizeRow(const QRgb* src, uchar* dst, int count) {
+	for (int x = 0; x < count; ++x) {
+		const quint32 r = (src[x] >> 16) & 0xff;
+		const quint32 g = (src[x] >> 8) & 0xff;
+		const quint32 b = src[x] & 0xff;
+		dst[x] = static_cast<uchar>(((r * 6) >> 8) * 42 + ((g * 7) >> 8) * 6 + ((b * 6) >> 8));
+	}
+}
+
+class GifLzwWriter {
+public:
+	explicit GifLzwWriter(QByteArray& out) : mOut(out), mBits(0), mBitCount(0) {}
+
+	void write(quint32 code, int size) {
+		mBits |= code << mBitCount;
+		mBitCount += size;
+
+		while (mBitCount >= 8) {
+			mBlock.append(static_cast<char>(mBits & 0xff));
+			mBits >>= 8;
+			mBitCount -= 8;
+
+			if (mBlock.size() == 255)
+				flush();
+		}
+	}
+
+	void finish() {
+		if (mBitCount > 0)
+			mBlock.append(static_cast<char>(mBits & 0xff));
+		flush();
+		mOut.append('\0');
+	}
+
+private:
+	void flush() {
+		if (mBlock.isEmpty())
+			return;
+		mOut.append(static_cast<char>(mBlock.size()));
+		mOut.append(mBlock);
+		mBlock.clear();
+	}
+
+	QByteArray& mOut;
+	QByteArray mBlock;
+	quint32 mBits;
+	int mBitCount;
+};
+
+static void GifCompress(const uchar* pixels, int count, QByteArray& out) {
+	const int minCodeSize = 8;
+	const quint32 clearCode = 1 << minCodeSize;
+	const int tableSize = 8191; // prime, comfortably above the 4096 codes
+
+	// Open addressing table from (prefix code, next pixel) to code
+	std::vector<qint32> keys(tableSize, -1);
+	std::vector<quint16> codes(tableSize);
+
+	GifLzwWriter writer(out);
+	int codeSize = minCodeSize + 1;
+	quint32 maxCode = clearCode + 1;
+	qint32 curCode = -1;
+
+	out.append(static_cast<char>(minCodeSize));
+	writer.write(clearCode, codeSize);
+
+	for (int ix = 0; ix < count; ++ix) {
+		const quint32 next = pixels[ix];
+
+		if (curCode < 0) {
+			curCode = next;
+			continue;
+		}
+
+		const qint32 key = (curCode << 8) | next;
+		int slot = key % tableSize;
+
+		while (keys[slot] >= 0 && keys[slot] != key)
+			slot = (slot + 1) % tableSize;
+
+		if (keys[slot] == key) {
+			curCode = codes[slot];
+			continue;
+		}
+
+		writer.write(curCode, codeSize);
+		keys[slot] = key;
+		codes[slot] = ++maxCode;
+
+		if (maxCode >= (1u << codeSize))
+			codeSize++;
+
+		if (maxCode == 4095) {
+			writer.write(clearCode, codeSize);
+			std::fill(keys.begin(), keys.end(), -1);
+			codeSize = minCodeSize + 1;
+			maxCode = clearCode + 1;
+		}
+
+		curCode = next;
+	}
+
+	writer.write(curCode, codeSize);
+
+	// The decoder adds one more entry on reading the last code and
+	// widens its codes when that fills the table, so EOI must follow suit.
+	if (maxCode + 1 >= (1u << codeSize) && codeSize < 12)
+		codeSize++;
+
+	writer.write(clearCode + 1, codeSize);
+	writer.finish();
+}
+
+class CutyAnimWriter {
+public:
+	CutyAnimWriter(CutyCapt::OutputFormat format, int frames, int interval)
+	    : mFormat(format), mFrames(frames), mInterval(interval), mSequence(0) {}
+
+	bool begin(const QString& path, const QSize& size);
+	void addFrame(const QImage& image, const QRect& rect);
+	bool finish();
+
+private:
+	CutyCapt::OutputFormat mFormat;
+	int mFrames;
+	int mInterval;
+	quint32 mSequence;
+	QFile mFile;
+};
+
+bool CutyAnimWriter::begin(const QString& path, const QSize& size) {
+	mFile.setFileName(path);
+	if (!mFile.open(QIODevice::WriteOnly))
+		return false;
+
+	switch (mFormat) {
+		case CutyCapt::GifFormat: {
+			QByteArray head("GIF89a");
+			QDataStream s(&head, QIODevice::Append);
+			s.setByteOrder(QDataStream::LittleEndian);
+			s << quint16(size.width()) << quint16(size.height());
+			s << quint8(0xf7) << quint8(0) << quint8(0); // 256 entry global colour table
+
+			for (int ix = 0; ix < 256; ++ix) {
+				if (ix < 252)
+					s << quint8((ix / 42) * 255 / 5) << quint8((ix / 6 % 7) * 255 / 6)
+					  << quint8((ix % 6) * 255 / 5);
+				else
+					s << quint8(0) << quint8(0) << quint8(0);
+			}
+
+			// Loop forever
+			head.append("\x21\xff\x0bNETSCAPE2.0\x03\x01\x00\x00\x00", 19);
+			mFile.write(head);
+			break;
+		}
+		case CutyCapt::MngFormat: {
+			mFile.write("\x8aMNG\r\n\x1a\n", 8);
+
+			QByteArray mhdr;
+			QDataStream s(&mhdr, QIODevice::WriteOnly);
+			s << quint32(size.width()) << quint32(size.height()) << quint32(1000);
+			s << quint32(0) << quint32(0) << quint32(0) << quint32(0);
+			PngChunk(&mFile, "MHDR", mhdr);
+
+			// Loop forever, like the GIF output
+			QByteArray term;
+			QDataStream t(&term, QIODevice::WriteOnly);
+			t << quint8(3) << quint8(0) << quint32(0) << quint32(0x7fffffff);
+			PngChunk(&mFile, "TERM", term);
+
+			// Framing mode 1: every layer is a frame drawn over the previous one
+			QByteArray fram;
+			QDataStream f(&fram, QIODevice::WriteOnly);
+			f << quint8(1) << quint8(0) << quint8(2) << quint8(0) << quint8(0) << quint8(0);
+			f << quint32(mInterval);
+			PngChunk(&mFile, "FRAM", fram);
+			break;
+		}
+		default: {
+			mFile.write("\x89PNG\r\n\x1a\n", 8);
+			PngChunk(&mFile, "IHDR", PngHeader(size));
+
+			QByteArray actl;
+			QDataStream s(&actl, QIODevice::WriteOnly);
+			s << quint32(mFrames) << quint32(0);
+			PngChunk(&mFile, "acTL", actl);
+		}
+	}
+
+	return mFile.error() == QFileDevice::NoError;
+}
+
+void CutyAnimWriter::addFrame(const QImage& image, const QRect& rect) {
+	switch (mFormat) {
+		case CutyCapt::GifFormat: {
+			QByteArray frame;
+			QDataStream s(&frame, QIODevice::WriteOnly);
+			s.setByteOrder(QDataStream::LittleEndian);
+
+			// Graphic control extension, disposal method 1 keeps the frame
+			s << quint8(0x21) << quint8(0xf9) << quint8(4) << quint8(0x04);
+			s << quint16((mInterval + 5) / 10) << quint8(0) << quint8(0);
+
+			s << quint8(0x2c) << quint16(rect.left()) << quint16(rect.top());
+			s << quint16(rect.width()) << quint16(rect.height()) << quint8(0);
+
+			QByteArray indices(rect.width() * rect.height(), Qt::Uninitialized);
+			uchar* dst = reinterpret_cast<uchar*>(indices.data());
+
+			for (int y = rect.top(); y <= rect.bottom(); ++y, dst += rect.width())
+				QuantizeRow(reinterpret_cast<const QRgb*>(image.constScanLine(y)) + rect.left(), dst,
+				            rect.width());
+
+			GifCompress(reinterpret_cast<const uchar*>(indices.constData()), indices.size(), frame);
+			mFile.write(frame);
+			break;
+		}
+		case CutyCapt::MngFormat: {
+			QByteArray defi;
+			QDataStream s(&defi, QIODevice::WriteOnly);
+			s << quint16(0) << quint8(0) << quint8(0);
+			s << qint32(rect.left()) << qint32(rect.top());
+			PngChunk(&mFile, "DEFI", defi);
+
+			PngChunk(&mFile, "IHDR", PngHeader(rect.size()));
+			PngChunk(&mFile, "IDAT", PngImageData(image, rect));
+			PngChunk(&mFile, "IEND", QByteArray());
+			break;
+		}
+		default: {
+			QByteArray fctl;
+			QDataStream s(&fctl, QIODevice::WriteOnly);
+			s << mSequence++ << quint32(rect.width()) << quint32(rect.height());
+			s << quint32(rect.left()) << quint32(rect.top());
+			s << quint16(qMin(mInterval, 0xffff)) << quint16(1000) << quint8(0) << quint8(0);
+			PngChunk(&mFile, "fcTL", fctl);
+
+			// The first frame doubles as the default image
+			if (mSequence == 1) {
+				PngChunk(&mFile, "IDAT", PngImageData(image, rect));
+				break;
+			}
+
+			QByteArray fdat;
+			QDataStream f(&fdat, QIODevice::WriteOnly);
+			f << mSequence++;
+			fdat.append(PngImageData(image, rect));
+			PngChunk(&mFile, "fdAT", fdat);
+		}
+	}
+}
+
+bool CutyAnimWriter::finish() {
+	switch (mFormat) {
+		case CutyCapt::GifFormat:
+			mFile.write("\x3b", 1);
+			break;
+		case CutyCapt::MngFormat:
+			PngChunk(&mFile, "MEND", QByteArray());
+			break;
+		default:
+			PngChunk(&mFile, "IEND", QByteArray());
+	}
+
+	mFile.close();
+	return mFile.error() == QFileDevice::NoError;
+}
+
+// Bounding box of the pixels that differ between two equally sized frames
+static QRect ChangedRect(const QImage& prev, const QImage& next) {
+	const int width = next.width();
+	const int height = next.height();
+	const size_t bytes = width * sizeof(QRgb);
+
+	int top = 0;
+	while (top < height && memcmp(prev.constScanLine(top), next.constScanLine(top), bytes) == 0)
+		++top;
+
+	// Nothing changed, a single pixel keeps the frame timing intact
+	if (top == height)
+		return QRect(0, 0, 1, 1);
+
+	int bottom = height - 1;
+	while (memcmp(prev.constScanLine(bottom), next.constScanLine(bottom), bytes) == 0)
+		--bottom;
+
+	int left = width;
+	int right = -1;
+
+	for (int y = top; y <= bottom; ++y) {
+		const QRgb* a = reinterpret_cast<const QRgb*>(prev.constScanLine(y));
+		const QRgb* b = reinterpret_cast<const QRgb*>(next.constScanLine(y));
+
+		int x = 0;
+		while (x < left && a[x] == b[x])
+			++x;
+		left = x;
+
+		x = width - 1;
+		while (x > right && a[x] == b[x])
+			--x;
+		right = x;
+	}
+
+	return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+// Artifact bundles. All entries are held in memory and then written
+// front to back, as a ustar archive or as a zip file with deflate used
+// where it helps, so the bundle never needs temporary files or seeks.
+
+typedef QVector<QPair<QString, QByteArray>> CutyBundle;
+
+static const char* CutyNavigationScript =
+    "JSON.stringify(performance.getEntriesByType('navigation')[0] || null)";
+
+static bool WriteTar(const QString& path, const CutyBundle& entries) {
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	const qint64 now = QDateTime::currentSecsSinceEpoch();
+
+	for (const auto& entry : entries) {
+		QByteArray header(512, '\0');
+		char* h = header.data();
+
+		qstrncpy(h, entry.first.toUtf8().constData(), 100);
+		memcpy(h + 100, "0000644", 7);
+		memcpy(h + 108, "0000000", 7);
+		memcpy(h + 116, "0000000", 7);
+		qsnprintf(h + 124, 12, "%011llo", static_cast<unsigned long long>(entry.second.size()));
+		qsnprintf(h + 136, 12, "%011llo", static_cast<unsigned long long>(now));
+		memset(h + 148, ' ', 8);
+		h[156] = '0';
+		memcpy(h + 257, "ustar", 6);
+		memcpy(h + 263, "00", 2);
+
+		// The checksum is computed with its own field set to spaces
+		unsigned int sum = 0;
+		for (const char c : header)
+			sum += static_cast<uchar>(c);
+		qsnprintf(h + 148, 8, "%06o", sum);
+
+		file.write(header);
+		file.write(entry.second);
+		file.write(QByteArray((512 - entry.second.size() % 512) % 512, '\0'));
+	}
+
+	file.write(QByteArray(1024, '\0'));
+	file.close();
+	return file.error() == QFileDevice::NoError;
+}
+
+static bool WriteZip(const QString& path, const CutyBundle& entries) {
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	const QDateTime now = QDateTime::currentDateTime();
+	const quint16 time =
+	    (now.time().hour() << 11) | (now.time().minute() << 5) | (now.time().second() / 2);
+	const quint16 date =
+	    ((now.date().year() - 1980) << 9) | (now.date().month() << 5) | now.date().day();
+
+	QDataStream s(&file);
+	s.setByteOrder(QDataStream::LittleEndian);
+
+	QByteArray directory;
+	QDataStream d(&directory, QIODevice::WriteOnly);
+	d.setByteOrder(QDataStream::LittleEndian);
+
+	for (const auto& entry : entries) {
+		const QByteArray name = entry.first.toUtf8();
+		const quint32 crc = Crc32(entry.second);
+		const quint32 offset = file.pos();
+
+		// Raw deflate is the zlib stream without its two byte header and
+		// adler32 trailer; already compressed images are stored as they are.
+		quint16 method = 8;
+		QByteArray data = qCompress(entry.second);
+		data = data.mid(6, data.size() - 10);
+
+		if (data.size() >= entry.second.size()) {
+			method = 0;
+			data = entry.second;
+		}
+
+		// General purpose flag 0x0800 marks the names as UTF-8
+		s << quint32(0x04034b50) << quint16(20) << quint16(0x0800) << method << time << date;
+		s << crc << quint32(data.size()) << quint32(entry.second.size());
+		s << quint16(name.size()) << quint16(0);
+		file.write(name);
+		file.write(data);
+
+		d << quint32(0x02014b50) << quint16(20) << quint16(20) << quint16(0x0800) << method;
+		d << time << date << crc << quint32(data.size()) << quint32(entry.second.size());
+		d << quint16(name.size()) << quint16(0) << quint16(0) << quint16(0) << quint16(0);
+		d << quint32(0) << offset;
+		d.writeRawData(name.constData(), name.size());
+	}
+
+	const quint32 offset = file.pos();
+	file.write(directory);
+
+	s << quint32(0x06054b50) << quint16(0) << quint16(0);
+	s << quint16(entries.size()) << quint16(entries.size());
+	s << quint32(directory.size()) << offset << quint16(0);
+
+	file.close();
+	return file.error() == QFileDevice::NoError;
+}
+
 // TODO: Consider merging some of main() and CutyCap
 
 CutyCapt::CutyCapt(CutyPage* page, const QString& output, int delay, OutputFormat format,
@@ -154,12 +710,54 @@ CutyCapt::CutyCapt(CutyPage* page, const QString& output, int delay, OutputForma
 	mScriptProp = scriptProp;
 	mScriptCode = scriptCode;
 	mScriptObj = new QObject();
+	mFrames = 1;
+	mFrameInterval = 100;
+	mFrameCount = 0;
+	mAnim = nullptr;
+	mRetries = 0;
+	mAttempt = 0;
+	mRendererGone = false;
+	mMaterializeLazy = false;
+	mLazyMaterialized = false;
+	mBudget = nullptr;
+	mLoadElapsed = -1;
+	mLoadTimer.start();
+
+	mDelayTimer.setSingleShot(true);
+	connect(&mDelayTimer, &QTimer::timeout, this, &CutyCapt::Delayed);
+	connect(&mFrameTimer, &QTimer::timeout, this, &CutyCapt::NextFrame);
+	connect(&mLazyTimer, &QTimer::timeout, this, &CutyCapt::PollLazy);
 
 	// This is not really nice, but some restructuring work is
 	// needed anyway, so this should not be that bad for now.
 	mPage->setCutyCapt(this);
 }
 
+void CutyCapt::setFrames(int frames, int interval) {
+	mFrames = frames;
+	mFrameInterval = interval;
+}
+
+void CutyCapt::setRequest(const QWebEngineHttpRequest& request) {
+	mRequest = request;
+}
+
+void CutyCapt::setRetries(int retries) {
+	mRetries = retries;
+}
+
+void CutyCapt::setMaterializeLazy(bool materializeLazy) {
+	mMaterializeLazy = materializeLazy;
+}
+
+void CutyCapt::setNetworkBudget(CutyNetworkBudget* budget) {
+	mBudget = budget;
+}
+
+void CutyCapt::setBundle(const QString& bundle) {
+	mBundle = bundle;
+}
+
 void CutyCapt::InitialLayoutCompleted() {
 	if (!mSilent)
 		std::cerr << "WebEngine completed initial layout" << std::endl;
@@ -171,6 +769,15 @@ void CutyCapt::InitialLayoutCompleted() {
 }
 
 void CutyCapt::DocumentComplete(bool ok) {
+	// A load that failed because the renderer died is handled by RenderProcessTerminated
+	if (mRendererGone)
+		return;
+
+	// Stopping the load for the network budget makes it fail, but
+	// what did load is what the budget asks to be captured.
+	if (!ok && mBudget && mBudget->isCut())
+		ok = true;
+
 	if (!mSilent && !ok) {
 		std::cerr << "WebEngine failed to completely load url" << std::endl;
 		QApplication::exit(1);
@@ -179,6 +786,7 @@ void CutyCapt::DocumentComplete(bool ok) {
 		std::cerr << "WebEngine completely downloaded document" << std::endl;
 
 	mSawDocumentComplete = true;
+	mLoadElapsed = mLoadTimer.elapsed();
 
 	if (/*mSawInitialLayout && */ mSawDocumentComplete && mSawGeometryChange)
 		TryDelayedRender();
@@ -202,15 +810,52 @@ void CutyCapt::TryDelayedRender() {
 	if (!mPage->getAlertString().isEmpty())
 		return;
 
+	if (mMaterializeLazy && !mLazyMaterialized) {
+		MaterializeLazy();
+		return;
+	}
+
 	if (mDelay > 0) {
-		QTimer::singleShot(mDelay, this, SLOT(Delayed()));
+		mDelayTimer.start(mDelay);
 		return;
 	}
 
 	saveSnapshot();
 }
 
+void CutyCapt::MaterializeLazy() {
+	if (!mSilent)
+		std::clog << "Materializing lazy content" << std::endl;
+
+	mLazyStarted.start();
+	mPage->page()->runJavaScript(CutyLazyScript);
+	mLazyTimer.start(CutyLazyPollInterval);
+}
+
+void CutyCapt::PollLazy() {
+	mPage->page()->runJavaScript("window.__cutyLazyDone === true", [this](const QVariant& result) {
+		// An earlier poll, the timeout or a crash got here first
+		if (!mLazyTimer.isActive())
+			return;
+
+		bool expired = mLazyStarted.elapsed() > CutyLazyMaxWait;
+
+		if (!result.toBool() && !expired)
+			return;
+
+		if (expired && !mSilent)
+			std::clog << "Lazy content did not settle, capturing anyway" << std::endl;
+
+		mLazyTimer.stop();
+		mLazyMaterialized = true;
+		TryDelayedRender();
+	});
+}
+
 void CutyCapt::Timeout() {
+	if (mRendererGone)
+		return;
+
 	if (!mSilent)
 		std::clog << "Timeout reached" << std::endl;
 
@@ -218,6 +863,9 @@ void CutyCapt::Timeout() {
 }
 
 void CutyCapt::Delayed() {
+	if (mRendererGone)
+		return;
+
 	saveSnapshot();
 }
 
@@ -231,6 +879,62 @@ void CutyCapt::onSizeChanged(const QSizeF& size) {
 	mSawGeometryChange = true;
 }
 
+void CutyCapt::RenderProcessTerminated(QWebEnginePage::RenderProcessTerminationStatus status,
+                                       int exitCode) {
+	if (status == QWebEnginePage::NormalTerminationStatus)
+		return;
+
+	if (!mSilent)
+		std::cerr << "Renderer process terminated (status " << status << ", exit code " << exitCode
+		          << ")" << std::endl;
+
+	// Nothing that is still pending can produce a meaningful capture now
+	mRendererGone = true;
+	mTimeoutTimer.stop();
+	mDelayTimer.stop();
+	mFrameTimer.stop();
+	mLazyTimer.stop();
+
+	if (mAnim) {
+		delete mAnim;
+		mAnim = nullptr;
+		QFile::remove(mOutput);
+	}
+
+	if (mAttempt >= mRetries) {
+		QApplication::exit(CutyExitRendererCrashed);
+		return;
+	}
+
+	int backoff = 1000 << qMin(mAttempt++, 5);
+
+	if (!mSilent)
+		std::clog << "Retrying in " << backoff << " ms (attempt " << mAttempt << " of " << mRetries
+		          << ")" << std::endl;
+
+	QTimer::singleShot(backoff, this, SLOT(Retry()));
+}
+
+void CutyCapt::Retry() {
+	mRendererGone = false;
+	mSawInitialLayout = false;
+	mSawDocumentComplete = false;
+	mLazyMaterialized = false;
+
+	// The page keeps its geometry, so mSawGeometryChange stays valid
+	if (mTimeoutTimer.interval() > 0)
+		mTimeoutTimer.start();
+
+	if (mBudget)
+		mBudget->reset();
+
+	// Timings in the bundle manifest describe this attempt only
+	mLoadElapsed = -1;
+	mLoadTimer.start();
+
+	mPage->load(mRequest);
+}
+
 void CutyCapt::pdfPrintFinish(const QString& file, bool success) {
 	if (!success && !mSilent) {
 		std::cerr << "Failed to print page to PDF '" << file.toStdString() << "'" << std::endl;
@@ -262,6 +966,16 @@ void CutyCapt::saveSnapshot() {
 
 	QString mOutput{ this->mOutput };
 	mTimeoutTimer.stop();
+	mLazyTimer.stop();
+
+	// Already recording an animation, e.g. the alert came in late
+	if (mAnim)
+		return;
+
+	if (!mBundle.isEmpty()) {
+		saveBundle(format);
+		return;
+	}
 
 	switch (mFormat) {
 		case SvgFormat: {
@@ -303,16 +1017,33 @@ void CutyCapt::saveSnapshot() {
 		}
 		default: {
 			// mPage->grab().save(mOutput, format);
-			QImage image(mViewSize, QImage::Format_ARGB32);
-			painter.begin(&image);
-			if (mSmooth) {
-				painter.setRenderHint(QPainter::SmoothPixmapTransform);
-				painter.setRenderHint(QPainter::Antialiasing);
-				painter.setRenderHint(QPainter::TextAntialiasing);
-				painter.setRenderHint(QPainter::HighQualityAntialiasing);
+			QImage image = renderImage(mViewSize);
+
+			if (mFrames > 1) {
+				// GIF stores dimensions in 16 bits, APNG and MNG in 32
+				if (mFormat == GifFormat && (image.width() > 0xffff || image.height() > 0xffff)) {
+					std::cerr << "Page of " << image.width() << "x" << image.height()
+					          << " is too large for GIF, use .png (APNG) or .mng instead" << std::endl;
+					QApplication::exit(1);
+					return;
+				}
+
+				mAnim = new CutyAnimWriter(mFormat, mFrames, mFrameInterval);
+
+				if (!mAnim->begin(mOutput, image.size())) {
+					std::cerr << "Failed to open '" << mOutput.toStdString() << "'" << std::endl;
+					QApplication::exit(1);
+					return;
+				}
+
+				mAnim->addFrame(image, image.rect());
+				mLastFrame = image;
+				mFrameCount = 1;
+
+				mFrameTimer.start(mFrameInterval);
+				return;
 			}
-			mPage->render(&painter);
-			painter.end();
+
 			// TODO: add quality
 			image.save(mOutput, format);
 			QApplication::quit();
@@ -320,6 +1051,665 @@ void CutyCapt::saveSnapshot() {
 	};
 }
 
+QImage CutyCapt::renderImage(const QSize& size) {
+	QPainter painter;
+	QImage image(size, QImage::Format_ARGB32);
+	painter.begin(&image);
+	if (mSmooth) {
+		painter.setRenderHint(QPainter::SmoothPixmapTransform);
+		painter.setRenderHint(QPainter::Antialiasing);
+		painter.setRenderHint(QPainter::TextAntialiasing);
+		painter.setRenderHint(QPainter::HighQualityAntialiasing);
+	}
+	mPage->render(&painter);
+	painter.end();
+	return image;
+}
+
+void CutyCapt::saveBundle(const char* format) {
+	QByteArray imageFormat(format ? format : "");
+
+	// Vector, text and animation formats have their own entries or no raster writer
+	if (!QImageWriter::supportedImageFormats().contains(imageFormat))
+		imageFormat = "png";
+
+	QBuffer buffer;
+	buffer.open(QIODevice::WriteOnly);
+	renderImage(mViewSize).save(&buffer, imageFormat.constData());
+
+	const QString image = "capture." + QString::fromLatin1(imageFormat);
+	const qint64 captured = mLoadTimer.elapsed();
+	QWebEnginePage* page = mPage->page();
+
+	CutyBundle entries;
+	entries.append({ image, buffer.data() });
+
+	page->toPlainText([this, page, entries, image, captured](const QString& text) mutable {
+		entries.append({ "text.txt", text.toUtf8() });
+
+		page->toHtml([this, page, entries, image, captured](const QString& html) mutable {
+			entries.append({ "page.html", html.toUtf8() });
+
+			page->runJavaScript(CutyNavigationScript, [this, entries, image, captured](
+			                                              const QVariant& navigation) mutable {
+				entries.append({ "manifest.json", bundleManifest(image, captured, navigation.toString()) });
+
+				bool ok = mBundle.endsWith(".zip", Qt::CaseInsensitive) ? WriteZip(mBundle, entries)
+				                                                       : WriteTar(mBundle, entries);
+
+				if (!ok) {
+					std::cerr << "Failed to write bundle '" << mBundle.toStdString() << "'" << std::endl;
+					QApplication::exit(1);
+					return;
+				}
+
+				QApplication::quit();
+			});
+		});
+	});
+}
+
+QByteArray CutyCapt::bundleManifest(const QString& image, qint64 captured,
+                                    const QString& navigation) {
+	QJsonObject viewport;
+	viewport["width"] = mViewSize.width();
+	viewport["height"] = mViewSize.height();
+
+	QJsonObject timing;
+	timing["loadFinished"] = mLoadElapsed;
+	timing["captured"] = captured;
+	timing["navigation"] = QJsonDocument::fromJson(navigation.toUtf8()).object();
+
+	// Qt WebEngine does not expose response headers, these are the ones we sent
+	QJsonObject headers;
+	for (const QByteArray& name : mRequest.headers())
+		headers[QString::fromLatin1(name)] = QString::fromLatin1(mRequest.header(name));
+
+	QJsonObject manifest;
+	manifest["url"] = QString::fromLatin1(mRequest.url().toEncoded());
+	manifest["finalUrl"] = QString::fromLatin1(mPage->page()->url().toEncoded());
+	manifest["title"] = mPage->page()->title();
+	manifest["status"] = mSawDocumentComplete ? "loaded" : "timeout";
+	manifest["attempt"] = mAttempt + 1;
+	manifest["image"] = image;
+	manifest["viewport"] = viewport;
+	manifest["timing"] = timing;
+	manifest["requestHeaders"] = headers;
+
+	if (mBudget)
+		manifest["network"] = mBudget->summary();
+
+	return QJsonDocument(manifest).toJson();
+}
+
+void CutyCapt::NextFrame() {
+	// Later frames keep the size of the first one even if the page grows
+	QImage image = renderImage(mLastFrame.size());
+
+	mAnim->addFrame(image, ChangedRect(mLastFrame, image));
+	mLastFrame = image;
+
+	if (++mFrameCount < mFrames)
+		return;
+
+	mFrameTimer.stop();
+
+	bool ok = mAnim->finish();
+	delete mAnim;
+	mAnim = nullptr;
+
+	if (!ok) {
+		std::cerr << "Failed to write '" << mOutput.toStdString() << "'" << std::endl;
+		QApplication::exit(1);
+		return;
+	}
+
+	QApplication::quit();
+}
+
+// Network budgets. Qt WebEngine has no way to abort a single subresource
+// or to see response sizes, so the interceptor records every request and
+// blocks those over --max-requests, while the resource timing list of the
+// page tells which requests completed and how many bytes they transferred.
+// When a request is overdue or the byte budget is exceeded the whole load
+// is stopped, so loadFinished fires and the capture goes ahead with what
+// has arrived; anything requested afterwards is blocked.
+
+static const int CutyBudgetPollInterval = 250;
+
+// Runs in every frame. Resource timing keeps only 150 entries unless told
+// otherwise, and it leaves out requests that failed, so those are collected
+// from the error events of the elements that made them. Frames have their
+// own resource timing, which they post up to the top document; only there
+// does the poll below look, and the deadline of top document requests is
+// unaffected by whatever frames load.
+static const char* CutyTimingScript = R"(
+(function() {
+  performance.setResourceTimingBufferSize(100000);
+
+  var top = window === window.top;
+  if (top) {
+    window.__cutyFailed = [];
+    window.__cutyFrames = [];
+    window.addEventListener('message', function(e) {
+      var timing = e.data && e.data.__cutyTiming;
+      if (!timing)
+        return;
+      window.__cutyFrames = window.__cutyFrames.concat(timing.entries);
+      window.__cutyFailed = window.__cutyFailed.concat(timing.failed);
+    });
+  }
+
+  function report(entries, failed) {
+    if (top)
+      window.__cutyFailed = window.__cutyFailed.concat(failed);
+    else
+      window.top.postMessage({ __cutyTiming: { entries: entries, failed: failed } }, '*');
+  }
+
+  window.addEventListener('error', function(e) {
+    var t = e.target;
+    if (t && t !== window && (t.src || t.href))
+      report([], [t.src || t.href]);
+  }, true);
+
+  if (!top) {
+    new PerformanceObserver(function(list) {
+      report(list.getEntries().map(function(e) {
+        return [e.name, e.transferSize || e.encodedBodySize || 0];
+      }), []);
+    }).observe({ type: 'resource', buffered: true });
+  }
+})();
+)";
+
+static const char* CutyResourceScript = R"(
+JSON.stringify({
+  entries: performance.getEntriesByType('navigation')
+    .concat(performance.getEntriesByType('resource'))
+    .map(function(e) { return [e.name, e.transferSize || e.encodedBodySize || 0]; })
+    .concat(window.__cutyFrames || []),
+  failed: window.__cutyFailed || []
+})
+)";
+
+// Whether resource timing reports requests of this type
+static bool TimedByDocument(QWebEngineUrlRequestInfo::ResourceType type) {
+	switch (type) {
+		case QWebEngineUrlRequestInfo::ResourceTypeSubFrame:
+		case QWebEngineUrlRequestInfo::ResourceTypeStylesheet:
+		case QWebEngineUrlRequestInfo::ResourceTypeScript:
+		case QWebEngineUrlRequestInfo::ResourceTypeImage:
+		case QWebEngineUrlRequestInfo::ResourceTypeFontResource:
+		case QWebEngineUrlRequestInfo::ResourceTypeSubResource:
+		case QWebEngineUrlRequestInfo::ResourceTypeObject:
+		case QWebEngineUrlRequestInfo::ResourceTypeMedia:
+		case QWebEngineUrlRequestInfo::ResourceTypeXhr:
+			return true;
+		default:
+			return false;
+	}
+}
+
+CutyInterceptor::CutyInterceptor(int maxRequests) {
+	mMaxRequests = maxRequests;
+	mAllowed = 0;
+}
+
+// Installed with setUrlRequestInterceptor, so this runs on the UI thread
+void CutyInterceptor::interceptRequest(QWebEngineUrlRequestInfo& info) {
+	// The document itself is never cut off
+	if (info.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeMainFrame)
+		return;
+
+	Request request{ QString::fromLatin1(info.requestUrl().toEncoded(QUrl::RemoveFragment)),
+		               info.resourceType(), QDateTime::currentMSecsSinceEpoch(), mBlockReason };
+
+	if (request.blocked.isNull() && mMaxRequests > 0 && mAllowed >= mMaxRequests)
+		request.blocked = "max-requests";
+
+	if (request.blocked.isNull())
+		mAllowed++;
+	else
+		info.block(true);
+
+	mRequests.append(request);
+}
+
+void CutyInterceptor::reset() {
+	mAllowed = 0;
+	mBlockReason = QString{};
+	mRequests.clear();
+}
+
+void CutyInterceptor::blockAll(const QString& reason) {
+	mBlockReason = reason;
+}
+
+const QVector<CutyInterceptor::Request>& CutyInterceptor::requests() const {
+	return mRequests;
+}
+
+CutyNetworkBudget::CutyNetworkBudget(CutyPage* page, int resourceTimeout, int maxRequests,
+                                     qint64 maxBytes, bool silent)
+    : mInterceptor(maxRequests) {
+	mPage = page;
+	mResourceTimeout = resourceTimeout;
+	mMaxBytes = maxBytes;
+	mSilent = silent;
+	mBytes = 0;
+
+	mPage->page()->profile()->setUrlRequestInterceptor(&mInterceptor);
+
+	if (mResourceTimeout <= 0 && mMaxBytes <= 0)
+		return;
+
+	QWebEngineScript script;
+	script.setSourceCode(CutyTimingScript);
+	script.setInjectionPoint(QWebEngineScript::DocumentCreation);
+	script.setWorldId(QWebEngineScript::MainWorld);
+	script.setRunsOnSubFrames(true);
+	mPage->page()->scripts().insert(script);
+
+	mPollTimer.setInterval(CutyBudgetPollInterval);
+	connect(&mPollTimer, &QTimer::timeout, this, &CutyNetworkBudget::Poll);
+	mPollTimer.start();
+}
+
+CutyNetworkBudget::~CutyNetworkBudget() {
+	mPage->page()->profile()->setUrlRequestInterceptor(nullptr);
+}
+
+// Starts over for a new attempt at loading the page
+void CutyNetworkBudget::reset() {
+	mInterceptor.reset();
+	mCompleted.clear();
+	mBytes = 0;
+	mCutReason = QString{};
+	mCutOff = QJsonArray{};
+
+	if (mResourceTimeout > 0 || mMaxBytes > 0)
+		mPollTimer.start();
+}
+
+bool CutyNetworkBudget::isCut() const {
+	return !mCutReason.isNull();
+}
+
+void CutyNetworkBudget::LoadFinished() {
+	mPollTimer.stop();
+}
+
+void CutyNetworkBudget::Poll() {
+	mPage->page()->runJavaScript(CutyResourceScript, [this](const QVariant& result) {
+		if (!mPollTimer.isActive())
+			return;
+
+		const QJsonObject timing = QJsonDocument::fromJson(result.toString().toUtf8()).object();
+
+		mBytes = 0;
+		for (const QJsonValue& value : timing["entries"].toArray()) {
+			const QJsonArray entry = value.toArray();
+			mCompleted.insert(entry.at(0).toString());
+			mBytes += static_cast<qint64>(entry.at(1).toDouble());
+		}
+
+		for (const QJsonValue& value : timing["failed"].toArray())
+			mCompleted.insert(value.toString());
+
+		if (mMaxBytes > 0 && mBytes > mMaxBytes) {
+			Cut("max-bytes");
+			return;
+		}
+
+		if (mResourceTimeout <= 0)
+			return;
+
+		const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+		for (const CutyInterceptor::Request& request : mInterceptor.requests()) {
+			if (Pending(request) && now - request.started > mResourceTimeout) {
+				Cut("resource-timeout");
+				return;
+			}
+		}
+	});
+}
+
+bool CutyNetworkBudget::Pending(const CutyInterceptor::Request& request) const {
+	return request.blocked.isNull() && TimedByDocument(request.type) &&
+	       !mCompleted.contains(request.url);
+}
+
+void CutyNetworkBudget::Cut(const QString& reason) {
+	const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+	mPollTimer.stop();
+	mCutReason = reason;
+	mInterceptor.blockAll(reason);
+
+	for (const CutyInterceptor::Request& request : mInterceptor.requests()) {
+		if (!Pending(request))
+			continue;
+
+		QJsonObject entry;
+		entry["url"] = request.url;
+		entry["reason"] = reason;
+		entry["elapsed"] = now - request.started;
+		mCutOff.append(entry);
+	}
+
+	if (!mSilent)
+		std::clog << "Network budget exceeded (" << reason.toStdString() << "), stopping "
+		          << mCutOff.size() << " pending requests" << std::endl;
+
+	mPage->page()->triggerAction(QWebEnginePage::Stop);
+}
+
+QJsonObject CutyNetworkBudget::summary() {
+	const QVector<CutyInterceptor::Request>& requests = mInterceptor.requests();
+	QJsonArray cutOff = mCutOff;
+
+	for (const CutyInterceptor::Request& request : requests) {
+		if (request.blocked.isNull())
+			continue;
+
+		QJsonObject entry;
+		entry["url"] = request.url;
+		entry["reason"] = request.blocked;
+		entry["elapsed"] = 0;
+		cutOff.append(entry);
+	}
+
+	QJsonObject summary;
+	summary["requests"] = requests.size();
+	summary["bytes"] = mBytes;
+	summary["cut"] = isCut();
+	summary["reason"] = mCutReason;
+	summary["cutOff"] = cutOff;
+	return summary;
+}
+
+bool CutyNetworkBudget::writeSummary(const QString& path) {
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	file.write(QJsonDocument(summary()).toJson());
+	return file.commit();
+}
+
+// Spool directory job queue. Pending jobs are `<name>.job` files holding one
+// command line option per line. A worker claims a job by renaming it to
+// `<name>.<worker>.run`; rename(2) is atomic on local and network filesystems,
+// so exactly one worker wins. The owner keeps changing the modification time
+// of the claimed file while the capture runs; a claim whose modification time
+// other workers see unchanged for the lease time belongs to a crashed worker
+// and is claimed again in the same way. Each job runs in a child CutyCapt
+// process with the spool as working directory, so relative --out paths end
+// up next to the job file.
+
+static const int CutySpoolPollInterval = 1000;
+
+static bool SpoolRename(const QString& from, const QString& to) {
+	return std::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+}
+
+CutySpool::CutySpool(const QString& dir, const QStringList& defaults, int lease, bool silent) {
+	mDir = QDir(dir);
+	mDefaults = defaults;
+	mLease = lease;
+	mSilent = silent;
+
+	// Worker names must not contain dots, they delimit the claimed file name.
+	// Containers often share a host name and all run as pid 1, hence the
+	// random part.
+	QString host = QSysInfo::machineHostName();
+	host.replace(QRegularExpression("[^A-Za-z0-9_-]"), "_");
+	mWorker = QString("%1-%2-%3")
+	              .arg(host)
+	              .arg(QCoreApplication::applicationPid())
+	              .arg(QUuid::createUuid().toString(QUuid::Id128).left(8));
+
+	mProcess.setWorkingDirectory(mDir.absolutePath());
+	mProcess.setProcessChannelMode(QProcess::MergedChannels);
+	connect(&mProcess, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
+	        &CutySpool::JobFinished);
+	connect(&mProcess, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+		if (error == QProcess::FailedToStart)
+			JobFinished(-1, QProcess::CrashExit);
+	});
+
+	mPollTimer.setInterval(CutySpoolPollInterval);
+	connect(&mPollTimer, &QTimer::timeout, this, &CutySpool::Poll);
+
+	mLeaseTimer.setInterval(mLease / 3);
+	connect(&mLeaseTimer, &QTimer::timeout, this, &CutySpool::RenewLease);
+}
+
+void CutySpool::Poll() {
+	if (!mJobName.isNull())
+		return;
+
+	if (ClaimJob() || ReclaimJob())
+		return;
+
+	// Keep polling while other workers still hold jobs, one of them
+	// might crash and leave its job for us to reclaim.
+	if (mDir.entryList(QStringList() << "*.job" << "*.run", QDir::Files).isEmpty()) {
+		if (!mSilent)
+			std::clog << "Spool " << mDir.path().toStdString() << " is empty" << std::endl;
+
+		QCoreApplication::quit();
+		return;
+	}
+
+	mPollTimer.start();
+}
+
+bool CutySpool::ClaimJob() {
+	const QStringList jobs = mDir.entryList(QStringList() << "*.job", QDir::Files, QDir::Name);
+
+	for (const QString& job : jobs) {
+		QString name = job.left(job.length() - 4);
+		QString claim = mDir.filePath(name + "." + mWorker + ".run");
+
+		if (!SpoolRename(mDir.filePath(job), claim))
+			continue;
+
+		mClaimPath = claim;
+		StartJob(name);
+		return true;
+	}
+
+	return false;
+}
+
+bool CutySpool::ReclaimJob() {
+	const QStringList runs = mDir.entryList(QStringList() << "*.run", QDir::Files, QDir::Name);
+
+	// Forget claims that have finished or moved on
+	for (auto it = mLeases.begin(); it != mLeases.end();) {
+		if (runs.contains(it.key()))
+			++it;
+		else
+			it = mLeases.erase(it);
+	}
+
+	for (const QString& run : runs) {
+		QFileInfo info(mDir.filePath(run));
+		const QDateTime modified = info.lastModified();
+
+		// The modification time is only compared with itself, and the time
+		// it stayed the same is measured here, so clocks of different hosts
+		// sharing the spool never need to agree.
+		auto lease = mLeases.find(run);
+		if (lease == mLeases.end() || lease->modified != modified) {
+			lease = mLeases.insert(run, Lease{ modified, QElapsedTimer() });
+			lease->unchanged.start();
+			continue;
+		}
+
+		if (!lease->unchanged.hasExpired(mLease))
+			continue;
+
+		QString name = run.left(run.length() - 4);
+		name = name.left(name.lastIndexOf('.'));
+		QString claim = mDir.filePath(name + "." + mWorker + ".run");
+
+		if (!SpoolRename(info.filePath(), claim))
+			continue;
+
+		if (!mSilent)
+			std::clog << "Reclaiming expired job " << name.toStdString() << std::endl;
+
+		mClaimPath = claim;
+		StartJob(name);
+		return true;
+	}
+
+	return false;
+}
+
+bool CutySpool::TouchLease() {
+	// ExistingOnly, as the file is gone if another worker took the job over
+	QFile file(mClaimPath);
+	if (!file.open(QIODevice::ReadWrite | QIODevice::ExistingOnly))
+		return false;
+
+	return file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+}
+
+void CutySpool::StartJob(const QString& name) {
+	mPollTimer.stop();
+	mJobName = name;
+	mStarted = QDateTime::currentDateTimeUtc();
+
+	// Renew right away; failing means another worker reclaimed the
+	// job between the rename and now.
+	if (!TouchLease()) {
+		mJobName = QString{};
+		mPollTimer.start();
+		return;
+	}
+
+	QStringList args = mDefaults;
+
+	QFile file(mClaimPath);
+	if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		QTextStream stream(&file);
+		stream.setCodec("utf-8");
+
+		while (!stream.atEnd()) {
+			QString line = stream.readLine().trimmed();
+
+			if (line.isEmpty() || line.startsWith('#'))
+				continue;
+
+			args << line;
+		}
+
+		file.close();
+	}
+
+	if (!mSilent)
+		std::clog << "Worker " << mWorker.toStdString() << " running job " << name.toStdString()
+		          << std::endl;
+
+	mLeaseTimer.start();
+	mProcess.setStandardOutputFile(mDir.filePath(name + ".log"));
+	mProcess.start(QCoreApplication::applicationFilePath(), args);
+}
+
+void CutySpool::RenewLease() {
+	if (TouchLease())
+		return;
+
+	if (!mSilent)
+		std::cerr << "Lost lease on job " << mJobName.toStdString() << std::endl;
+
+	// Someone else owns the job now; drop it without writing any results
+	mLeaseTimer.stop();
+	mJobName = QString{};
+	mProcess.kill();
+}
+
+void CutySpool::JobFinished(int exitCode, QProcess::ExitStatus exitStatus) {
+	mLeaseTimer.stop();
+
+	if (!mJobName.isNull() && TouchLease()) {
+		bool ok = exitStatus == QProcess::NormalExit && exitCode == 0;
+
+		WriteStatus(exitCode, exitStatus);
+		SpoolRename(mClaimPath, mDir.filePath(mJobName + (ok ? ".done" : ".failed")));
+	}
+
+	mJobName = QString{};
+	mClaimPath = QString{};
+	Poll();
+}
+
+void CutySpool::WriteStatus(int exitCode, QProcess::ExitStatus exitStatus) {
+	QJsonObject status;
+	status["job"] = mJobName;
+	status["worker"] = mWorker;
+	status["started"] = mStarted.toString(Qt::ISODateWithMs);
+	status["finished"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+	status["exitStatus"] = exitStatus == QProcess::NormalExit ? "normal" : "crashed";
+	status["exitCode"] = exitCode;
+	status["arguments"] = QJsonArray::fromStringList(mProcess.arguments());
+
+	// QSaveFile writes to a temporary and renames, so readers never see half a manifest
+	QSaveFile file(mDir.filePath(mJobName + ".status.json"));
+	if (!file.open(QIODevice::WriteOnly))
+		return;
+
+	file.write(QJsonDocument(status).toJson());
+	file.commit();
+}
+
+int SpoolMain(int argc, char* argv[]) {
+	QString spool;
+	QStringList defaults;
+	bool silent = false;
+	int lease = 60000;
+
+	// Everything but the spool options is passed on to each job
+	for (int ax = 1; ax < argc; ++ax) {
+		const char* s = argv[ax];
+
+		if (strncmp("--spool=", s, 8) == 0) {
+			spool = QFile::decodeName(s + 8);
+		} else if (strncmp("--spool-lease=", s, 14) == 0) {
+			lease = strtol(s + 14, nullptr, 0);
+		} else {
+			if (strcmp("--silent", s) == 0)
+				silent = true;
+
+			defaults << QString::fromLocal8Bit(s);
+		}
+	}
+
+	QCoreApplication app(argc, argv);
+
+	if (spool.isEmpty() || !QDir(spool).exists()) {
+		std::cerr << "Spool directory '" << spool.toStdString() << "' does not exist" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Leases are renewed every third of the lease time, which has to be
+	// at least a second apart to show on filesystems with coarse mtimes.
+	if (lease < 3000) {
+		std::cerr << "Spool lease must be at least 3000 ms" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	CutySpool worker{ spool, defaults, lease, silent };
+	QTimer::singleShot(0, &worker, &CutySpool::Poll);
+
+	return app.exec();
+}
+
 void CaptHelp(void) {
 	printf("%s",
 	       " ----------------------------------------------------------------------------------\n"
@@ -329,12 +1719,16 @@ void CaptHelp(void) {
 	       "  --url=<url>                        The URL to capture (http:...|file:...|...)    \n"
 	       "  --out=<path>                       The target file (.png|pdf|ps|svg|jpeg|...)    \n"
 	       "  --out-format=<f>                   Like extension in --out, overrides heuristic  \n"
+	       "  --out-bundle=<path>                Image, text, HTML and manifest in a .tar|.zip \n"
 	       // "  --out-quality=<int>             Output format quality from 1 to 100           \n"
 	       "  --min-width=<int>                  Minimal width for the image (default: 800)    \n"
 	       "  --min-height=<int>                 Minimal height for the image (default: 600)   \n"
 	       "  --force-gpu-mem-available-mb=<int> Set the memory in Chromium for rendering      \n"
 	       "  --max-wait=<ms>                    Don't wait more than (default: 90000, inf: 0) \n"
 	       "  --delay=<ms>                       After successful load, wait (default: 0)      \n"
+	       "  --materialize-lazy                 Load lazy images and frames before capturing  \n"
+	       "  --frames=<int>                     Record an animation, for gif, png and mng     \n"
+	       "  --frame-interval=<ms>              Time between animation frames (default: 100)  \n"
 	       // "  --user-styles=<url>             Location of user style sheet (deprecated)     \n"
 	       // "  --user-style-path=<path>        Location of user style sheet file, if any
 	       // (disabled until the insertion script is written) \n"
@@ -370,7 +1764,14 @@ void CaptHelp(void) {
 	       "  --debug-print-alerts               Prints out alert(...) strings for debugging.  \n"
 #endif
 	       "  --smooth                           Attempt to enable Qt's high-quality settings. \n"
+	       "  --resource-timeout=<ms>            Stop loading when a resource takes longer     \n"
+	       "  --max-requests=<int>               Block subresources beyond this many           \n"
+	       "  --max-bytes=<int>                  Stop loading after this many bytes            \n"
+	       "  --network-summary=<path>           Write JSON listing what the above cut off     \n"
 	       "  --insecure                         Ignore SSL/TLS certificate errors             \n"
+	       "  --retries=<int>                    Reload after renderer crashes (default: 0)    \n"
+	       "  --spool=<dir>                      Run queued job files from <dir>, see below    \n"
+	       "  --spool-lease=<ms>                 Reclaim jobs of silent workers after (60000)  \n"
 	       " ----------------------------------------------------------------------------------\n"
 	       "  <f> is svg,ps,pdf,itext,html,png,jpeg,mng,tiff,gif,bmp,ppm,xbm,xpm               \n"
 	       " ----------------------------------------------------------------------------------\n"
@@ -385,6 +1786,22 @@ void CaptHelp(void) {
 	       " This an experimental and easily abused and misused feature. Use with caution.     \n"
 	       " ----------------------------------------------------------------------------------\n"
 #endif
+	       " With `spool` CutyCapt works through the `<name>.job` files in a directory that    \n"
+	       " may be shared by many workers on many hosts. Job files hold options as above,     \n"
+	       " one per line; the other command line options are defaults for every job. Each     \n"
+	       " job is claimed by renaming it, its output is written relative to the directory,   \n"
+	       " and `<name>.status.json`, `<name>.log` and `<name>.done|failed` record the run.   \n"
+	       " Jobs of workers that stop renewing their lease are picked up again. The worker    \n"
+	       " exits once no pending or running jobs are left in the directory.                  \n"
+	       " ----------------------------------------------------------------------------------\n"
+	       " `out-bundle` replaces `out`: one load yields a .tar or .zip holding the raster    \n"
+	       " image in the `out-format` (default: png), the inner text, the HTML and a JSON     \n"
+	       " manifest with URLs, viewport, timing and request headers. It cannot be combined   \n"
+	       " with `out` or `frames`.                                                           \n"
+	       " ----------------------------------------------------------------------------------\n"
+	       " When the renderer process crashes the page is loaded again after a backoff of     \n"
+	       " 1, 2, 4, ... seconds, up to `retries` times; after that CutyCapt exits with 2.    \n"
+	       " ----------------------------------------------------------------------------------\n"
 	       " http://cutycapt.sf.net - (c) 2003-2013 Bjoern Hoehrmann - bjoern@hoehrmann.de     \n"
 	       "");
 }
@@ -399,6 +1816,13 @@ int main(int argc, char* argv[]) {
 	uint32_t argMaxWait = 90000;
 	uint8_t argVerbosity = 0;
 	bool argSmooth = false;
+	int argFrames = 1;
+	int argFrameInterval = 100;
+	int argRetries = 0;
+	bool argMaterializeLazy = false;
+	int argResourceTimeout = 0;
+	int argMaxRequests = 0;
+	qint64 argMaxBytes = 0;
 
 	const char* argUrl = NULL;
 	// const char* argUserStyle = NULL;
@@ -407,10 +1831,16 @@ int main(int argc, char* argv[]) {
 	// const char* argIconDbPath = NULL;
 	const char* argInjectScript = NULL;
 	const char* argScriptObject = NULL;
+	const char* argNetworkSummary = NULL;
+	const char* argOutBundle = NULL;
 	QString argOut;
 
 	CutyCapt::OutputFormat format = CutyCapt::OtherFormat;
 
+	for (int ax = 1; ax < argc; ++ax)
+		if (strncmp("--spool=", argv[ax], 8) == 0)
+			return SpoolMain(argc, argv);
+
 	QApplication::setAttribute(Qt::AA_UseSoftwareOpenGL, true);
 	QQuickWindow::setSceneGraphBackend(QSGRendererInterface::Software);
 
@@ -451,6 +1881,9 @@ int main(int argc, char* argv[]) {
 		} else if (strcmp("--smooth", s) == 0) {
 			argSmooth = 1;
 			continue;
+		} else if (strcmp("--materialize-lazy", s) == 0) {
+			argMaterializeLazy = true;
+			continue;
 
 #if CUTYCAPT_SCRIPT
 		} else if (strcmp("--debug-print-alerts", s) == 0) {
@@ -483,6 +1916,20 @@ int main(int argc, char* argv[]) {
 		} else if (strncmp("--delay", s, nlen) == 0) {
 			// TODO: see above
 			argDelay = strtol(value, nullptr, 0);
+		} else if (strncmp("--frames", s, nlen) == 0) {
+			argFrames = strtol(value, nullptr, 0);
+		} else if (strncmp("--frame-interval", s, nlen) == 0) {
+			argFrameInterval = strtol(value, nullptr, 0);
+		} else if (strncmp("--retries", s, nlen) == 0) {
+			argRetries = strtol(value, nullptr, 0);
+		} else if (strncmp("--resource-timeout", s, nlen) == 0) {
+			argResourceTimeout = strtol(value, nullptr, 0);
+		} else if (strncmp("--max-requests", s, nlen) == 0) {
+			argMaxRequests = strtol(value, nullptr, 0);
+		} else if (strncmp("--max-bytes", s, nlen) == 0) {
+			argMaxBytes = strtoll(value, nullptr, 0);
+		} else if (strncmp("--network-summary", s, nlen) == 0) {
+			argNetworkSummary = value;
 		} else if (strncmp("--max-wait", s, nlen) == 0) {
 			// TODO: see above
 			argMaxWait = strtol(value, nullptr, 0);
@@ -558,6 +2005,8 @@ int main(int argc, char* argv[]) {
 			body = QByteArray(value);
 		} else if (strncmp("--user-agent", s, nlen) == 0) {
 			page.setUserAgent(value);
+		} else if (strncmp("--out-bundle", s, nlen) == 0) {
+			argOutBundle = value;
 		} else if (strncmp("--out-format", s, nlen) == 0) {
 			for (int ix = 0; CutyExtMap[ix].id != CutyCapt::OtherFormat; ++ix) {
 				if (strcmp(value, CutyExtMap[ix].identifier) == 0)
@@ -597,7 +2046,18 @@ int main(int argc, char* argv[]) {
 		}
 	}
 
-	if (argUrl == NULL || argOut == NULL || argHelp) {
+	if (argFrames > 1 && format != CutyCapt::GifFormat && format != CutyCapt::PngFormat &&
+	    format != CutyCapt::MngFormat)
+		argHelp = true;
+
+	// A bundle holds a single raster image and takes the place of --out
+	if (argOutBundle != NULL && (argOut != NULL || argFrames > 1 ||
+	                             !(QByteArray(argOutBundle).toLower().endsWith(".tar") ||
+	                               QByteArray(argOutBundle).toLower().endsWith(".zip"))))
+		argHelp = true;
+
+	if (argUrl == NULL || (argOut == NULL && argOutBundle == NULL) || argHelp || argFrames < 1 ||
+	    argFrameInterval < 1) {
 		CaptHelp();
 		return EXIT_FAILURE;
 	}
@@ -627,8 +2087,26 @@ int main(int argc, char* argv[]) {
 	CutyCapt main{ &page,      argOut,      argDelay,  format,   scriptProp,
 		             scriptCode, argInsecure, argSmooth, argSilent };
 
+	main.setFrames(argFrames, argFrameInterval);
+	main.setMaterializeLazy(argMaterializeLazy);
+
+	if (argOutBundle)
+		main.setBundle(QString::fromLocal8Bit(argOutBundle));
+
+	// Without any of the budget options requests go through untouched
+	QScopedPointer<CutyNetworkBudget> budget;
+
+	if (argResourceTimeout > 0 || argMaxRequests > 0 || argMaxBytes > 0 || argNetworkSummary) {
+		budget.reset(new CutyNetworkBudget(&page, argResourceTimeout, argMaxRequests, argMaxBytes,
+		                                   argSilent));
+		main.setNetworkBudget(budget.data());
+	}
+
 	app.connect(&page, SIGNAL(loadFinished(bool)), &main, SLOT(DocumentComplete(bool)));
 
+	if (budget)
+		app.connect(&page, SIGNAL(loadFinished(bool)), budget.data(), SLOT(LoadFinished()));
+
 	// Qt WebEngine removes the ability to check whether a page has layout it's components
 	// This checking functionality needs to be rewritten in JavaScript, and potentially Qt websockets
 	// / channels
@@ -640,6 +2118,9 @@ int main(int argc, char* argv[]) {
 
 	app.connect(page.page(), &QWebEnginePage::pdfPrintingFinished, &main, &CutyCapt::pdfPrintFinish);
 
+	app.connect(page.page(), &QWebEnginePage::renderProcessTerminated, &main,
+	            &CutyCapt::RenderProcessTerminated);
+
 	if (argMaxWait > 0) {
 		// TODO: Should this also register one for the application?
 		QTimer& timer = main.mTimeoutTimer;
@@ -684,6 +2165,8 @@ int main(int argc, char* argv[]) {
 	if (!body.isNull())
 		req.setPostData(body);
 
+	main.setRequest(req);
+	main.setRetries(argRetries);
 	page.load(req);
 
 	QSize argSize(argMinWidth, argMinHeight);
@@ -693,5 +2176,12 @@ int main(int argc, char* argv[]) {
 	page.resize(argSize);
 	page.show();
 
-	return app.exec();
+	int status = app.exec();
+
+	if (argNetworkSummary && !budget->writeSummary(QString::fromLocal8Bit(argNetworkSummary))) {
+		std::cerr << "Failed to write network summary '" << argNetworkSummary << "'" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return status;
 }
@@ -4,7 +4,15 @@
 #	include <QtWebEngineWidgets>
 #endif
 
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QProcess>
+#include <QWebEngineUrlRequestInterceptor>
+
 class CutyCapt;
+class CutyAnimWriter;
+class CutyNetworkBudget;
 class CutyPage : public QWebEngineView {
 	Q_OBJECT
 
@@ -59,20 +67,36 @@ public:
 	         const QString& scriptProp, const QString& scriptCode, bool insecure, bool smooth,
 	         bool silent);
 
+	void setFrames(int frames, int interval);
+	void setRequest(const QWebEngineHttpRequest& request);
+	void setRetries(int retries);
+	void setMaterializeLazy(bool materializeLazy);
+	void setNetworkBudget(CutyNetworkBudget* budget);
+	void setBundle(const QString& bundle);
+
 private slots:
 	void DocumentComplete(bool ok);
 	void InitialLayoutCompleted();
 	void JavaScriptWindowObjectCleared();
 	void Delayed();
 	void onSizeChanged(const QSizeF& size);
+	void NextFrame();
+	void Retry();
+	void PollLazy();
 
 public slots:
 	void Timeout();
 	void pdfPrintFinish(const QString&, bool success);
+	void RenderProcessTerminated(QWebEnginePage::RenderProcessTerminationStatus status,
+	                             int exitCode);
 
 private:
 	void TryDelayedRender();
+	void MaterializeLazy();
 	void saveSnapshot();
+	QImage renderImage(const QSize& size);
+	void saveBundle(const char* format);
+	QByteArray bundleManifest(const QString& image, qint64 captured, const QString& navigation);
 	bool mSawInitialLayout;
 	bool mSawDocumentComplete;
 	bool mSawGeometryChange;
@@ -89,7 +113,125 @@ protected:
 	bool mInsecure;
 	bool mSmooth;
 	bool mSilent;
+	int mFrames;
+	int mFrameInterval;
+	int mFrameCount;
+	QImage mLastFrame;
+	QTimer mFrameTimer;
+	CutyAnimWriter* mAnim;
+	QTimer mDelayTimer;
+	QWebEngineHttpRequest mRequest;
+	int mRetries;
+	int mAttempt;
+	bool mRendererGone;
+	bool mMaterializeLazy;
+	bool mLazyMaterialized;
+	QElapsedTimer mLazyStarted;
+	QTimer mLazyTimer;
+	CutyNetworkBudget* mBudget;
+	QString mBundle;
+	QElapsedTimer mLoadTimer;
+	qint64 mLoadElapsed;
 
 public:
 	QTimer mTimeoutTimer;
 };
+
+class CutyInterceptor : public QWebEngineUrlRequestInterceptor {
+	Q_OBJECT
+
+public:
+	struct Request {
+		QString url;
+		QWebEngineUrlRequestInfo::ResourceType type;
+		qint64 started;
+		QString blocked;
+	};
+
+	CutyInterceptor(int maxRequests);
+	void interceptRequest(QWebEngineUrlRequestInfo& info) override;
+	void reset();
+	void blockAll(const QString& reason);
+	const QVector<Request>& requests() const;
+
+protected:
+	int mMaxRequests;
+	int mAllowed;
+	QString mBlockReason;
+	QVector<Request> mRequests;
+};
+
+class CutyNetworkBudget : public QObject {
+	Q_OBJECT
+
+public:
+	CutyNetworkBudget(CutyPage* page, int resourceTimeout, int maxRequests, qint64 maxBytes,
+	                  bool silent);
+	~CutyNetworkBudget();
+	void reset();
+	bool isCut() const;
+	QJsonObject summary();
+	bool writeSummary(const QString& path);
+
+public slots:
+	void LoadFinished();
+
+private slots:
+	void Poll();
+
+private:
+	void Cut(const QString& reason);
+	bool Pending(const CutyInterceptor::Request& request) const;
+
+protected:
+	CutyPage* mPage;
+	int mResourceTimeout;
+	qint64 mMaxBytes;
+	bool mSilent;
+	qint64 mBytes;
+	CutyInterceptor mInterceptor;
+	QSet<QString> mCompleted;
+	QString mCutReason;
+	QJsonArray mCutOff;
+	QTimer mPollTimer;
+};
+
+class CutySpool : public QObject {
+	Q_OBJECT
+
+public:
+	CutySpool(const QString& dir, const QStringList& defaults, int lease, bool silent);
+
+public slots:
+	void Poll();
+
+private slots:
+	void RenewLease();
+	void JobFinished(int exitCode, QProcess::ExitStatus exitStatus);
+
+private:
+	bool ClaimJob();
+	bool ReclaimJob();
+	bool TouchLease();
+	void StartJob(const QString& name);
+	void WriteStatus(int exitCode, QProcess::ExitStatus exitStatus);
+
+	struct Lease {
+		QDateTime modified;
+		QElapsedTimer unchanged;
+	};
+
+protected:
+	QDir mDir;
+	QStringList mDefaults;
+	int mLease;
+	bool mSilent;
+	QString mWorker;
+	QString mJobName;
+	QString mClaimPath;
+	QDateTime mStarted;
+	QHash<QString, Lease> mLeases;
+	QProcess mProcess;
+	QTimer mPollTimer;
+	QTimer mLeaseTimer;
+};